@@ -0,0 +1,463 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  rt_lane.c
+ * @brief Real-time relay lane implementation. The relay thread never logs, allocates or talks to
+ *        Awa; it only pops commands, writes the relay and pushes results back to the telemetry
+ *        thread.
+ */
+
+/***************************************************************************************************
+ * Includes
+ **************************************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "rt_lane.h"
+
+/***************************************************************************************************
+ * Definitions
+ **************************************************************************************************/
+
+//! @cond Doxygen_Suppress
+#define RT_LANE_STACK_PREFAULT (16 * 1024)
+#define USEC_PER_SEC (1000000L)
+#define NSEC_PER_USEC (1000L)
+#define USEC_PER_MSEC (1000L)
+//! @endcond
+
+/** Single-producer/single-consumer ring, head is owned by the consumer and tail by the producer. */
+typedef struct
+{
+    RtLaneEvent slots[RT_LANE_QUEUE_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+} RtLaneQueue;
+
+/***************************************************************************************************
+ * Globals
+ **************************************************************************************************/
+
+/** Commands from the telemetry thread to the relay thread. */
+static RtLaneQueue g_commandQueue;
+/** Relay changes from the relay thread to the telemetry thread. */
+static RtLaneQueue g_relayQueue;
+/** Opto click edges from the GPIO callback thread to the telemetry thread. */
+static RtLaneQueue g_edgeQueue;
+/** Wakes the relay thread when a command is queued. */
+static int g_wakeupFd = -1;
+static pthread_t g_thread;
+static atomic_bool g_running;
+static int g_priority;
+/** Relay GPIO value file, opened before the relay thread starts. */
+static int g_relayFd = -1;
+static unsigned int g_relayHoldMs;
+/** Queue-to-relay latency statistics, written by the relay thread only. */
+static atomic_long g_worstUs;
+static atomic_long g_totalUs;
+static atomic_long g_count;
+static atomic_long g_droppedCommands;
+static atomic_long g_droppedEvents;
+static atomic_long g_relayWriteErrors;
+/** Whether the calling GPIO callback thread has had its scheduling policy checked. */
+static __thread bool g_edgeThreadChecked = false;
+/** Set when a GPIO callback thread could not be moved to SCHED_FIFO. */
+static atomic_bool g_edgeThreadFailed;
+
+/***************************************************************************************************
+ * Implementation
+ **************************************************************************************************/
+
+static bool Queue_Push(RtLaneQueue *queue, const RtLaneEvent *event)
+{
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head == RT_LANE_QUEUE_SIZE)
+    {
+        return false;
+    }
+    queue->slots[tail % RT_LANE_QUEUE_SIZE] = *event;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static bool Queue_Pop(RtLaneQueue *queue, RtLaneEvent *event)
+{
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+    *event = queue->slots[head % RT_LANE_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+static void Queue_Reset(RtLaneQueue *queue)
+{
+    atomic_store(&queue->head, 0);
+    atomic_store(&queue->tail, 0);
+}
+
+static long TimespecDiffUs(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * USEC_PER_SEC + (to->tv_nsec - from->tv_nsec) / NSEC_PER_USEC;
+}
+
+static void TimespecAddUs(struct timespec *ts, long us)
+{
+    ts->tv_sec += us / USEC_PER_SEC;
+    ts->tv_nsec += (us % USEC_PER_SEC) * NSEC_PER_USEC;
+    if (ts->tv_nsec >= USEC_PER_SEC * NSEC_PER_USEC)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= USEC_PER_SEC * NSEC_PER_USEC;
+    }
+}
+
+static void Wakeup(void)
+{
+    uint64_t one = 1;
+    ssize_t written = write(g_wakeupFd, &one, sizeof one);
+    (void)written;
+}
+
+/**
+ * @brief Sleep until woken or timeout expires. poll() times out on CLOCK_MONOTONIC, so wall clock
+ *        steps (NTP on a board without RTC) can't stretch the relay hold.
+ * @param timeoutMs time to wait, -1 to wait for wakeup only.
+ */
+static void WaitForWakeup(int timeoutMs)
+{
+    struct pollfd pfd = { .fd = g_wakeupFd, .events = POLLIN };
+    uint64_t count;
+
+    if (poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN))
+    {
+        ssize_t got = read(g_wakeupFd, &count, sizeof count);
+        (void)got;
+    }
+}
+
+/**
+ * @brief Touch the relay thread stack up front so it never page faults while actuating.
+ */
+static void PrefaultStack(void)
+{
+    volatile unsigned char buffer[RT_LANE_STACK_PREFAULT];
+    memset((void *)buffer, 0, sizeof buffer);
+}
+
+/**
+ * @brief Drive relay output. A single write() on an already open fd, no stdio or heap involved.
+ */
+static void SetRelay(bool state)
+{
+    if (pwrite(g_relayFd, state ? "1" : "0", 1, 0) != 1)
+    {
+        atomic_fetch_add(&g_relayWriteErrors, 1);
+    }
+}
+
+/**
+ * @brief Edge capture runs one step below the relay thread so an edge burst can't hold off a door
+ *        command.
+ */
+static int EdgePriority(void)
+{
+    return g_priority > RT_LANE_MIN_PRIORITY ? g_priority - 1 : RT_LANE_MIN_PRIORITY;
+}
+
+static void RecordLatency(long latencyUs)
+{
+    if (latencyUs > atomic_load(&g_worstUs))
+    {
+        atomic_store(&g_worstUs, latencyUs);
+    }
+    atomic_fetch_add(&g_totalUs, latencyUs);
+    atomic_fetch_add(&g_count, 1);
+}
+
+static void PublishRelayChange(bool state, long latencyUs, long commandUs, bool benchmark)
+{
+    RtLaneEvent event = { .type = RtLaneEvent_RelayChanged, .relayState = state, .latencyUs = latencyUs,
+                          .commandUs = commandUs, .benchmark = benchmark };
+
+    if (!Queue_Push(&g_relayQueue, &event))
+    {
+        atomic_fetch_add(&g_droppedEvents, 1);
+    }
+}
+
+static void *RtLane_Thread(void *arg)
+{
+    RtLaneEvent command;
+    struct timespec now, releaseAt = { 0, 0 };
+    bool relayOn = false;
+
+    (void)arg;
+    PrefaultStack();
+
+    while (atomic_load(&g_running))
+    {
+        if (relayOn)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long remainingUs = TimespecDiffUs(&now, &releaseAt);
+            if (remainingUs > 0)
+            {
+                WaitForWakeup((remainingUs + USEC_PER_MSEC - 1) / USEC_PER_MSEC);
+            }
+        }
+        else
+        {
+            WaitForWakeup(-1);
+        }
+
+        while (Queue_Pop(&g_commandQueue, &command))
+        {
+            SetRelay(true);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long latencyUs = TimespecDiffUs(&command.queued, &now);
+            RecordLatency(latencyUs);
+            relayOn = true;
+            releaseAt = now;
+            TimespecAddUs(&releaseAt, g_relayHoldMs * 1000L);
+            PublishRelayChange(true, latencyUs, TimespecDiffUs(&command.issued, &now), command.benchmark);
+        }
+
+        if (relayOn)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (TimespecDiffUs(&now, &releaseAt) <= 0)
+            {
+                SetRelay(false);
+                relayOn = false;
+                PublishRelayChange(false, -1, -1, false);
+            }
+        }
+    }
+
+    if (relayOn)
+    {
+        SetRelay(false);
+        PublishRelayChange(false, -1, -1, false);
+    }
+    return NULL;
+}
+
+bool RtLane_Start(int priority, const char *relayValuePath, unsigned int relayHoldMs)
+{
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = priority };
+    int err;
+
+    if (relayValuePath == NULL || priority < RT_LANE_MIN_PRIORITY || priority > RT_LANE_MAX_PRIORITY)
+    {
+        LOG(LOG_ERR, "Invalid parameter passsed to %s()", __func__);
+        return false;
+    }
+
+    g_relayFd = open(relayValuePath, O_WRONLY | O_CLOEXEC);
+    if (g_relayFd < 0)
+    {
+        LOG(LOG_ERR, "Failed to open relay GPIO %s: %s", relayValuePath, strerror(errno));
+        return false;
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        LOG(LOG_ERR, "Failed to lock process memory: %s", strerror(errno));
+        close(g_relayFd);
+        g_relayFd = -1;
+        return false;
+    }
+
+    Queue_Reset(&g_commandQueue);
+    Queue_Reset(&g_relayQueue);
+    Queue_Reset(&g_edgeQueue);
+    atomic_store(&g_worstUs, 0);
+    atomic_store(&g_totalUs, 0);
+    atomic_store(&g_count, 0);
+    atomic_store(&g_droppedCommands, 0);
+    atomic_store(&g_droppedEvents, 0);
+    atomic_store(&g_relayWriteErrors, 0);
+    atomic_store(&g_edgeThreadFailed, false);
+    g_priority = priority;
+    g_relayHoldMs = relayHoldMs;
+    g_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wakeupFd < 0)
+    {
+        LOG(LOG_ERR, "Failed to create relay lane wakeup: %s", strerror(errno));
+        close(g_relayFd);
+        g_relayFd = -1;
+        munlockall();
+        return false;
+    }
+    atomic_store(&g_running, true);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, RT_LANE_STACK_SIZE);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    err = pthread_create(&g_thread, &attr, RtLane_Thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0)
+    {
+        LOG(LOG_ERR, "Failed to start SCHED_FIFO relay thread: %s", strerror(err));
+        atomic_store(&g_running, false);
+        close(g_wakeupFd);
+        g_wakeupFd = -1;
+        close(g_relayFd);
+        g_relayFd = -1;
+        munlockall();
+        return false;
+    }
+
+    LOG(LOG_INFO, "Real-time relay lane running at SCHED_FIFO priority %d", priority);
+    return true;
+}
+
+void RtLane_Stop(void)
+{
+    if (!atomic_load(&g_running))
+    {
+        return;
+    }
+    atomic_store(&g_running, false);
+    Wakeup();
+    pthread_join(g_thread, NULL);
+    close(g_wakeupFd);
+    g_wakeupFd = -1;
+    close(g_relayFd);
+    g_relayFd = -1;
+    munlockall();
+}
+
+bool RtLane_Trigger(const struct timespec *issued, bool benchmark)
+{
+    RtLaneEvent event = { .type = RtLaneEvent_Trigger, .issued = *issued, .benchmark = benchmark };
+
+    clock_gettime(CLOCK_MONOTONIC, &event.queued);
+    if (!Queue_Push(&g_commandQueue, &event))
+    {
+        atomic_fetch_add(&g_droppedCommands, 1);
+        return false;
+    }
+    Wakeup();
+    return true;
+}
+
+bool RtLane_AttachEdgeCallbacks(void (*attach)(void))
+{
+    struct sched_param saved, param = { .sched_priority = EdgePriority() };
+    int policy, err;
+
+    pthread_getschedparam(pthread_self(), &policy, &saved);
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+        LOG(LOG_WARN, "Failed to raise edge capture to SCHED_FIFO: %s", strerror(err));
+    }
+
+    attach();
+
+    if (err == 0)
+    {
+        pthread_setschedparam(pthread_self(), policy, &saved);
+    }
+    return err == 0;
+}
+
+bool RtLane_TakeEdgeThreadFailure(void)
+{
+    return atomic_exchange(&g_edgeThreadFailed, false);
+}
+
+void RtLane_CaptureEdge(int channel, uint8_t state)
+{
+    RtLaneEvent event = { .type = RtLaneEvent_Edge, .channel = channel, .state = state };
+
+    gettimeofday(&event.time, NULL);
+
+    // Normally the callback thread inherited SCHED_FIFO in RtLane_AttachEdgeCallbacks(). If it
+    // was created elsewhere, promote it here and report when that is not permitted.
+    if (!g_edgeThreadChecked)
+    {
+        struct sched_param param;
+        int policy;
+
+        g_edgeThreadChecked = true;
+        if (pthread_getschedparam(pthread_self(), &policy, &param) != 0 || policy != SCHED_FIFO)
+        {
+            param.sched_priority = EdgePriority();
+            if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+            {
+                atomic_store(&g_edgeThreadFailed, true);
+            }
+        }
+    }
+
+    if (!Queue_Push(&g_edgeQueue, &event))
+    {
+        atomic_fetch_add(&g_droppedEvents, 1);
+    }
+}
+
+bool RtLane_PollEvent(RtLaneEvent *event)
+{
+    return Queue_Pop(&g_relayQueue, event) || Queue_Pop(&g_edgeQueue, event);
+}
+
+void RtLane_GetStats(RtLaneStats *stats)
+{
+    stats->worstUs = atomic_load(&g_worstUs);
+    stats->totalUs = atomic_load(&g_totalUs);
+    stats->count = atomic_load(&g_count);
+    stats->droppedCommands = atomic_load(&g_droppedCommands);
+    stats->droppedEvents = atomic_load(&g_droppedEvents);
+    stats->relayWriteErrors = atomic_load(&g_relayWriteErrors);
+}
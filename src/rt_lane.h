@@ -0,0 +1,155 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file rt_lane.h
+ * @brief Real-time relay lane. Door commands are handed to a dedicated SCHED_FIFO thread which
+ *        drives the relay, while opto click edges are timestamped where they are delivered.
+ *        All traffic with the telemetry (Awa) side goes through single-producer/single-consumer
+ *        wait-free queues, so a slow Awa operation can never delay a relay change.
+ */
+
+#ifndef RT_LANE_H
+#define RT_LANE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+//! \{
+#define RT_LANE_QUEUE_SIZE (32)
+#define RT_LANE_STACK_SIZE (64 * 1024)
+#define RT_LANE_MIN_PRIORITY (1)
+#define RT_LANE_MAX_PRIORITY (99)
+//! \}
+
+/** Kind of entry carried by the lane queues. */
+typedef enum
+{
+    RtLaneEvent_Trigger,        /**< Door trigger command, telemetry -> lane. */
+    RtLaneEvent_RelayChanged,   /**< Relay output changed, lane -> telemetry. */
+    RtLaneEvent_Edge            /**< Opto click edge, GPIO callback -> telemetry. */
+} RtLaneEventType;
+
+/** Fixed size queue entry, so queues can live in preallocated static storage. */
+typedef struct
+{
+    RtLaneEventType type;
+    /** Trigger: CLOCK_MONOTONIC time at which the command was received, stamped by the caller. */
+    struct timespec issued;
+    /** Trigger: CLOCK_MONOTONIC time at which the command was queued to the lane. */
+    struct timespec queued;
+    /** Trigger/RelayChanged: command was injected by the benchmark. */
+    bool benchmark;
+    /** RelayChanged: new relay state. */
+    bool relayState;
+    /** RelayChanged: queue-to-relay latency in microseconds, -1 for a timed release. */
+    long latencyUs;
+    /** RelayChanged: received-to-relay latency in microseconds, measured from issued. */
+    long commandUs;
+    /** Edge: opto click channel and GPIO_RAISING/GPIO_FALLING state. */
+    int channel;
+    uint8_t state;
+    /** Edge: wall clock time at which the edge was delivered. */
+    struct timeval time;
+} RtLaneEvent;
+
+/** Queue-to-relay latency statistics collected by the lane. */
+typedef struct
+{
+    long worstUs;
+    long totalUs;
+    long count;
+    long droppedCommands;
+    long droppedEvents;
+    long relayWriteErrors;
+} RtLaneStats;
+
+/**
+ * @brief Open relay GPIO, lock process memory and start the real-time relay thread.
+ * @param priority SCHED_FIFO priority of the relay thread.
+ * @param relayValuePath sysfs GPIO value file driving the relay. It is opened once here, the
+ *        relay thread only writes "1" or "0" to it.
+ * @param relayHoldMs time after the last trigger at which the relay is released.
+ * @return true on success, false otherwise.
+ */
+bool RtLane_Start(int priority, const char *relayValuePath, unsigned int relayHoldMs);
+
+/**
+ * @brief Stop the real-time thread, releasing the relay if it is still on.
+ */
+void RtLane_Stop(void);
+
+/**
+ * @brief Queue a door trigger command. Must only be called from the trigger intake thread.
+ * @param issued CLOCK_MONOTONIC time at which the command was received, reported back with the
+ *        relay change.
+ * @param benchmark command was injected by the benchmark, reported back with the relay change.
+ * @return false if the command queue is full and the command was dropped.
+ */
+bool RtLane_Trigger(const struct timespec *issued, bool benchmark);
+
+/**
+ * @brief Run attach with the calling thread temporarily at SCHED_FIFO, so GPIO callback threads
+ *        created while attaching inherit real-time priority before the first edge arrives.
+ * @param attach function attaching GPIO callbacks.
+ * @return false if real-time priority could not be set, callbacks are attached anyway.
+ */
+bool RtLane_AttachEdgeCallbacks(void (*attach)(void));
+
+/**
+ * @brief Check whether an edge was delivered on a thread that could not be moved to SCHED_FIFO.
+ *        Reported once, so the telemetry thread can log it.
+ * @return true the first time after such an edge, false otherwise.
+ */
+bool RtLane_TakeEdgeThreadFailure(void);
+
+/**
+ * @brief Timestamp and queue an opto click edge. Must only be called from the GPIO callback thread.
+ * @param channel opto click channel the edge was seen on.
+ * @param state GPIO_RAISING or GPIO_FALLING.
+ */
+void RtLane_CaptureEdge(int channel, uint8_t state);
+
+/**
+ * @brief Fetch the next relay or edge event. Must only be called from the telemetry thread.
+ * @param event filled with the dequeued event.
+ * @return true if an event was dequeued, false if there is nothing pending.
+ */
+bool RtLane_PollEvent(RtLaneEvent *event);
+
+/**
+ * @brief Read queue-to-relay latency statistics gathered since the lane was started.
+ * @param stats filled with current values.
+ */
+void RtLane_GetStats(RtLaneStats *stats);
+
+#endif /* RT_LANE_H */
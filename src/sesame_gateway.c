@@ -45,12 +45,15 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/time.h>
 #include <letmecreate/letmecreate.h>
 #include <awa/client.h>
 #include <awa/common.h>
 
 #include "log.h"
+#include "rt_lane.h"
 
 /***************************************************************************************************
  * Definitions
@@ -72,6 +75,9 @@
 #define DOOR_DURATION_RESOURCE_ID (5521)
 #define RELAY_MIKROBUS_INDEX MIKROBUS_1
 #define RELAY_CLICK_IDX RELAY2_CLICK_RELAY_1
+#define RELAY_GPIO_TYPE TYPE_PWM
+#define RELAY_GPIO_VALUE_PATH "/sys/class/gpio/gpio%d/value"
+#define GPIO_VALUE_PATH_SIZE (64)
 
 #define OPTO_OBJECT_ID (3200)
 #define OPTO_RESOURCE_ID (5500)
@@ -84,10 +90,19 @@
 #define OPERATION_TIMEOUT (5000)
 #define URL_PATH_SIZE (16)
 
+#define RELAY_HOLD_TIME_MS (3000)
+#define TRIGGER_INTAKE_WAIT_MS (100)
+#define BENCHMARK_RELAY_HOLD_MS (500)
+#define BENCHMARK_TRIGGER_GAP_MS (500)
+#define BENCHMARK_TRIGGER_JITTER_MS (1500)
+#define BENCHMARK_LOAD_OPERATIONS (5)
+#define USEC_PER_SEC (1000000L)
+#define NSEC_PER_USEC (1000L)
+
 //! @endcond
 
 void ChangeRelayState(bool state);
-void GarageDoorTrigger(void);
+void GarageDoorTrigger(const struct timespec *issued, bool benchmark);
 
 /***************************************************************************************************
  * Globals
@@ -113,7 +128,23 @@ AwaInteger g_doorTriggerCount = 0;
 AwaFloat g_doorOpenDuration = 0.0;
 AwaFloat g_doorCloseDuration = 0.0;
 AwaClientSession *session;
-bool g_relayState = false;
+atomic_bool g_relayState = false;
+/** Time after a trigger at which relay is released. */
+unsigned int g_relayHoldMs = RELAY_HOLD_TIME_MS;
+/** SCHED_FIFO priority of the relay lane, 0 when real-time mode is off. */
+int g_realTimePriority = 0;
+/** Number of synthetic door triggers to issue in benchmark mode, 0 when off. */
+int g_benchmarkCount = 0;
+/** Awa session receiving door trigger executes in real-time mode, away from telemetry. */
+static AwaClientSession *g_triggerSession = NULL;
+static pthread_t g_triggerThread;
+/** Arrival time of synthetic trigger waiting to be dispatched by main loop. */
+static struct timespec g_benchmarkIssued;
+static atomic_bool g_benchmarkTriggerPending;
+/** Command-to-relay latency of benchmark triggers, written by main loop only. */
+static atomic_long g_benchmarkSamples;
+static long g_benchmarkWorstUs = 0;
+static long g_benchmarkTotalUs = 0;
 
 
 /***************************************************************************************************
@@ -125,15 +156,44 @@ static char *getPath(char *buf, int objectID, int instanceID, int resourceID)
     sprintf(buf, "/%d/%d/%d", objectID, instanceID, resourceID);
 }
 
-static void doorTriggerCallback(const AwaExecuteArguments *arguments, void *context)
+static long ElapsedUs(const struct timespec *since)
 {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * USEC_PER_SEC + (now.tv_nsec - since->tv_nsec) / NSEC_PER_USEC;
+}
+
+/**
+ * @brief Handle door trigger execute.
+ * @param issued CLOCK_MONOTONIC time at which command was received
+ * @param benchmark command was injected by benchmark
+ */
+static void DoorTrigger(const struct timespec *issued, bool benchmark)
+{
+    if (g_realTimePriority > 0)
+    {
+        // Runs on trigger intake thread, door timings are reset on main thread once the relay
+        // lane reports the relay change
+        GarageDoorTrigger(issued, benchmark);
+        LOG(LOG_INFO, "Execute %d/%d/%d", DOOR_OBJECT_ID, DOOR_OBJ_INSTANCE_TRIGGER, DOOR_TRIGGER_RESOURCE_ID);
+        return;
+    }
 
     LOG(LOG_INFO, "Execute %d/%d/%d", DOOR_OBJECT_ID, DOOR_OBJ_INSTANCE_TRIGGER, DOOR_TRIGGER_RESOURCE_ID);
     g_openBegin.tv_sec = 0;
     g_openBegin.tv_usec = 0;
     g_closeBegin.tv_sec = 0;
     g_closeBegin.tv_usec = 0;
-    GarageDoorTrigger();
+    GarageDoorTrigger(issued, benchmark);
+}
+
+static void doorTriggerCallback(const AwaExecuteArguments *arguments, void *context)
+{
+    struct timespec issued;
+
+    clock_gettime(CLOCK_MONOTONIC, &issued);
+    DoorTrigger(&issued, false);
 }
 
 static void doorCounterResetCallback(const AwaExecuteArguments *arguments, void *context)
@@ -254,6 +314,10 @@ static void PrintUsage(const char *program)
            " -v : Debug level from 1 to 5\n"
            "      fatal(1), error(2), warning(3), info(4), debug(5) and max(>5)\n"
            "      default is info.\n"
+           " -r : Drive relay from a real-time thread at given SCHED_FIFO priority (1-99).\n"
+           " -b : Benchmark: inject given number of door triggers where executes are dispatched\n"
+           "      under synthetic telemetry load, report worst command-to-relay latency and exit.\n"
+           "      Every trigger switches the relay on and off, disconnect the door opener first.\n"
            " -h : Print help and exit.\n\n",
            program);
 }
@@ -269,7 +333,7 @@ static int ParseCommandArgs(int argc, char *argv[], const char **fptr)
 
     while (1)
     {
-        opt = getopt(argc, argv, "l:v:c:");
+        opt = getopt(argc, argv, "l:v:c:r:b:");
         if (opt == -1)
         {
             break;
@@ -294,6 +358,35 @@ static int ParseCommandArgs(int argc, char *argv[], const char **fptr)
             }
             break;
 
+        case 'r':
+            tmp = strtoul(optarg, NULL, 0);
+            if (tmp >= RT_LANE_MIN_PRIORITY && tmp <= RT_LANE_MAX_PRIORITY)
+            {
+                g_realTimePriority = tmp;
+            }
+            else
+            {
+                LOG(LOG_ERR, "Invalid real-time priority");
+                PrintUsage(argv[0]);
+                return -1;
+            }
+            break;
+
+        case 'b':
+            tmp = strtoul(optarg, NULL, 0);
+            if (tmp > 0)
+            {
+                g_benchmarkCount = tmp;
+                g_relayHoldMs = BENCHMARK_RELAY_HOLD_MS;
+            }
+            else
+            {
+                LOG(LOG_ERR, "Invalid benchmark trigger count");
+                PrintUsage(argv[0]);
+                return -1;
+            }
+            break;
+
         case 'h':
             PrintUsage(argv[0]);
             return 0;
@@ -340,28 +433,85 @@ static void setOptoClickStateResource(AwaClientSession *session, int instanceID,
     AwaClientSetOperation_Free(&operation);
 }
 
+/**
+ * @brief Resolve sysfs value file of the GPIO driving relay 1, so the real-time lane can write it
+ *        directly instead of going through LetMeCreate stdio helpers.
+ * @param buf filled with path
+ * @param size of buf
+ * @return true on success, false otherwise.
+ */
+static bool GetRelayValuePath(char *buf, size_t size)
+{
+    uint8_t pin;
+
+    if (gpio_get_pin(RELAY_MIKROBUS_INDEX, RELAY_GPIO_TYPE, &pin) < 0)
+    {
+        LOG(LOG_ERR, "Failed to find relay GPIO on mikrobus %d", RELAY_MIKROBUS_INDEX);
+        return false;
+    }
+    snprintf(buf, size, RELAY_GPIO_VALUE_PATH, pin);
+    return true;
+}
+
+/**
+ * @brief Account command-to-relay latency of a benchmark trigger.
+ * @param latencyUs measured latency
+ */
+static void RecordBenchmarkSample(long latencyUs)
+{
+    if (latencyUs > g_benchmarkWorstUs)
+    {
+        g_benchmarkWorstUs = latencyUs;
+    }
+    g_benchmarkTotalUs += latencyUs;
+    atomic_fetch_add(&g_benchmarkSamples, 1);
+}
+
 /**
  * @brief Trigger garage door movement/stop.
+ * @param issued CLOCK_MONOTONIC time at which command was received
+ * @param benchmark command was injected by benchmark, account its latency
  */
-void GarageDoorTrigger()
+void GarageDoorTrigger(const struct timespec *issued, bool benchmark)
 {
-    ChangeRelayState(true);
+    if (g_realTimePriority > 0)
+    {
+        if (!RtLane_Trigger(issued, benchmark))
+        {
+            LOG(LOG_ERR, "Relay lane command queue full, door trigger dropped");
+        }
+        return;
+    }
+
+    relay_click_enable_relay_1(RELAY_MIKROBUS_INDEX);
+    long latencyUs = ElapsedUs(issued);
+    g_relayState = true;
     gettimeofday(&g_sleepBegin, NULL);
+    LOG(LOG_INFO, "Changed relay state on Ci40 board to 1");
+    if (benchmark)
+    {
+        RecordBenchmarkSample(latencyUs);
+    }
 }
 
-void optoClickDoorOpenedCallback(uint8_t state)
+/**
+ * @brief Handle edge on Door-Opened sensor.
+ * @param state GPIO_RAISING or GPIO_FALLING
+ * @param edgeTime time at which edge was seen
+ */
+static void HandleDoorOpenedEdge(uint8_t state, const struct timeval *edgeTime)
 {
     LOG(LOG_INFO, "Door-Opened state change to %d", state == GPIO_RAISING ? 1 : 0);
     if (state == GPIO_RAISING)
     {
-        gettimeofday(&g_closeBegin, NULL);
+        g_closeBegin = *edgeTime;
     }
     else if (state == GPIO_FALLING)
     {
 
         if (g_openBegin.tv_sec != 0 && g_openBegin.tv_usec != 0)
         {
-            gettimeofday(&g_openEnd, NULL);
+            g_openEnd = *edgeTime;
             double openBegin = (double)g_openBegin.tv_sec + ((double)g_openBegin.tv_usec) / 1000000.0;
             double openEnd = (double)g_openEnd.tv_sec + ((double)g_openEnd.tv_usec) / 1000000.0;
             g_doorOpenDuration = openEnd - openBegin;
@@ -387,18 +537,23 @@ void optoClickDoorOpenedCallback(uint8_t state)
     setOptoClickStateResource(session, OPTO_OBJ_INSTANCE_DOOR_OPENED, g_optoOpenedState);
 }
 
-void optoClickDoorClosedCallback(uint8_t state)
+/**
+ * @brief Handle edge on Door-Closed sensor.
+ * @param state GPIO_RAISING or GPIO_FALLING
+ * @param edgeTime time at which edge was seen
+ */
+static void HandleDoorClosedEdge(uint8_t state, const struct timeval *edgeTime)
 {
     LOG(LOG_INFO, "Door-Closed state change to %d", state == GPIO_RAISING ? 1 : 0);
     if (state == GPIO_RAISING)
     {
-        gettimeofday(&g_openBegin, NULL);
+        g_openBegin = *edgeTime;
     }
     else if (state == GPIO_FALLING)
     {
         if (g_closeBegin.tv_sec != 0 && g_closeBegin.tv_usec != 0)
         {
-            gettimeofday(&g_closeEnd, NULL);
+            g_closeEnd = *edgeTime;
             double closeBegin = (double)g_closeBegin.tv_sec + ((double)g_closeBegin.tv_usec) / 1000000.0;
             double closeEnd = (double)g_closeEnd.tv_sec + ((double)g_closeEnd.tv_usec) / 1000000.0;
             g_doorCloseDuration = closeEnd - closeBegin;
@@ -425,7 +580,256 @@ void optoClickDoorClosedCallback(uint8_t state)
 
 }
 
+void optoClickDoorOpenedCallback(uint8_t state)
+{
+    if (g_realTimePriority > 0)
+    {
+        RtLane_CaptureEdge(OPTO_CHANNEL_DOOR_OPENED, state);
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    HandleDoorOpenedEdge(state, &now);
+}
+
+void optoClickDoorClosedCallback(uint8_t state)
+{
+    if (g_realTimePriority > 0)
+    {
+        RtLane_CaptureEdge(OPTO_CHANNEL_DOOR_CLOSED, state);
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    HandleDoorClosedEdge(state, &now);
+}
 
+/**
+ * @brief Attach Door-Opened/Door-Closed callbacks to Opto Click channels.
+ */
+static void AttachOptoClickCallbacks(void)
+{
+    opto_click_attach_callback(OPTO_MIKROBUS_INDEX, OPTO_CHANNEL_DOOR_OPENED, optoClickDoorOpenedCallback);
+    opto_click_attach_callback(OPTO_MIKROBUS_INDEX, OPTO_CHANNEL_DOOR_CLOSED, optoClickDoorClosedCallback);
+}
+
+/**
+ * @brief Drain relay changes and opto click edges reported by the real-time lane.
+ */
+static void ProcessRtLaneEvents(void)
+{
+    RtLaneEvent event;
+
+    if (RtLane_TakeEdgeThreadFailure())
+    {
+        LOG(LOG_WARN, "Opto click edges delivered at normal priority, SCHED_FIFO not permitted");
+    }
+
+    while (RtLane_PollEvent(&event))
+    {
+        switch (event.type)
+        {
+        case RtLaneEvent_RelayChanged:
+            g_relayState = event.relayState;
+            if (event.latencyUs >= 0)
+            {
+                g_openBegin.tv_sec = 0;
+                g_openBegin.tv_usec = 0;
+                g_closeBegin.tv_sec = 0;
+                g_closeBegin.tv_usec = 0;
+                LOG(LOG_INFO, "Changed relay state on Ci40 board to %d, queue-to-relay %ld us",
+                    event.relayState, event.latencyUs);
+                if (event.benchmark)
+                {
+                    RecordBenchmarkSample(event.commandUs);
+                }
+            }
+            else
+            {
+                LOG(LOG_INFO, "Changed relay state on Ci40 board to %d", event.relayState);
+            }
+            break;
+
+        case RtLaneEvent_Edge:
+            if (event.channel == OPTO_CHANNEL_DOOR_OPENED)
+            {
+                HandleDoorOpenedEdge(event.state, &event.time);
+            }
+            else if (event.channel == OPTO_CHANNEL_DOOR_CLOSED)
+            {
+                HandleDoorClosedEdge(event.state, &event.time);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Log queue-to-relay latency gathered by the real-time lane. It covers the lane only, not
+ *        time the command spent in awa before its callback ran.
+ */
+static void PrintRtLaneStats(void)
+{
+    RtLaneStats stats;
+
+    RtLane_GetStats(&stats);
+    LOG(LOG_INFO, "Relay lane: %ld commands, worst queue-to-relay %ld us, average %ld us",
+        stats.count, stats.worstUs, stats.count > 0 ? stats.totalUs / stats.count : 0);
+    if (stats.droppedCommands > 0 || stats.droppedEvents > 0)
+    {
+        LOG(LOG_WARN, "Relay lane: dropped %ld commands and %ld events", stats.droppedCommands,
+            stats.droppedEvents);
+    }
+    if (stats.relayWriteErrors > 0)
+    {
+        LOG(LOG_ERR, "Relay lane: %ld relay GPIO writes failed", stats.relayWriteErrors);
+    }
+}
+
+/**
+ * @brief Synthetic telemetry load for benchmark. Performs synchronous set operations on the main
+ *        session, on the same thread that dispatches door triggers, as edge telemetry does.
+ */
+static void PublishSyntheticTelemetry(void)
+{
+    char buf[20];
+    int i;
+
+    for (i = 0; i < BENCHMARK_LOAD_OPERATIONS; i++)
+    {
+        AwaClientSetOperation *operation = AwaClientSetOperation_New(session);
+        getPath(buf, DOOR_OBJECT_ID, DOOR_OBJ_INSTANCE_TRIGGER, DOOR_COUNTER_RESOURCE_ID);
+        AwaClientSetOperation_AddValueAsInteger(operation, buf, g_doorTriggerCount);
+        AwaClientSetOperation_Perform(operation, OPERATION_PERFORM_TIMEOUT);
+        AwaClientSetOperation_Free(&operation);
+        LOG(LOG_DBG, "Synthetic telemetry write %s", buf);
+    }
+}
+
+/**
+ * @brief Dispatch synthetic trigger injected by benchmark, at the point where door trigger
+ *        executes are dispatched: main loop by default, trigger intake thread in real-time mode.
+ */
+static void DispatchBenchmarkTrigger(void)
+{
+    if (atomic_exchange(&g_benchmarkTriggerPending, false))
+    {
+        struct timespec issued = g_benchmarkIssued;
+        DoorTrigger(&issued, true);
+    }
+}
+
+/**
+ * @brief Benchmark trigger source. Stamps each trigger as it "arrives" at a random point in time,
+ *        so measured latency includes waiting for dispatch. Next
+ *        trigger is only issued once relay has been released, so every sample is a real relay
+ *        off-to-on change.
+ */
+static void *BenchmarkTriggerThread(void *arg)
+{
+    int i;
+
+    for (i = 0; i < g_benchmarkCount && g_keepRunning; i++)
+    {
+        usleep((BENCHMARK_TRIGGER_GAP_MS + rand() % BENCHMARK_TRIGGER_JITTER_MS) * 1000);
+        clock_gettime(CLOCK_MONOTONIC, &g_benchmarkIssued);
+        atomic_store(&g_benchmarkTriggerPending, true);
+
+        while (g_keepRunning && atomic_load(&g_benchmarkSamples) <= i)
+        {
+            usleep(1000);
+        }
+        while (g_keepRunning && g_relayState)
+        {
+            usleep(1000);
+        }
+    }
+
+    g_keepRunning = 0;
+    return NULL;
+}
+
+/**
+ * @brief Log command-to-relay latency measured by benchmark.
+ */
+static void PrintBenchmarkStats(void)
+{
+    long samples = atomic_load(&g_benchmarkSamples);
+
+    LOG(LOG_INFO, "Benchmark (%s mode): %ld triggers, worst command-to-relay %ld us, average %ld us",
+        g_realTimePriority > 0 ? "real-time" : "normal", samples, g_benchmarkWorstUs,
+        samples > 0 ? g_benchmarkTotalUs / samples : 0);
+}
+
+/**
+ * @brief Receive door trigger executes on their own session, so they are dispatched straight to the
+ *        relay lane instead of waiting behind telemetry on main loop.
+ */
+static void *TriggerIntakeThread(void *arg)
+{
+    while (g_keepRunning)
+    {
+        AwaClientSession_Process(g_triggerSession, TRIGGER_INTAKE_WAIT_MS);
+        AwaClientSession_DispatchCallbacks(g_triggerSession);
+        DispatchBenchmarkTrigger();
+    }
+    return NULL;
+}
+
+/**
+ * @brief Connect trigger session, subscribe door trigger execute on it and start intake thread.
+ * @param subscription door trigger execute subscription
+ * @return true on success, false otherwise.
+ */
+static bool StartTriggerIntake(AwaClientChangeSubscription *subscription)
+{
+    g_triggerSession = AwaClientSession_New();
+    if (g_triggerSession == NULL || AwaClientSession_Connect(g_triggerSession) != AwaError_Success)
+    {
+        LOG(LOG_ERR, "Failed to establish trigger client session");
+        AwaClientSession_Free(&g_triggerSession);
+        return false;
+    }
+
+    AwaClientSubscribeOperation *subscribeOperation = AwaClientSubscribeOperation_New(g_triggerSession);
+    AwaClientSubscribeOperation_AddExecuteSubscription(subscribeOperation, subscription);
+    AwaError err = AwaClientSubscribeOperation_Perform(subscribeOperation, OPERATION_PERFORM_TIMEOUT);
+    AwaClientSubscribeOperation_Free(&subscribeOperation);
+
+    if (err != AwaError_Success || pthread_create(&g_triggerThread, NULL, TriggerIntakeThread, NULL) != 0)
+    {
+        LOG(LOG_ERR, "Failed to start door trigger intake");
+        AwaClientSession_Disconnect(g_triggerSession);
+        AwaClientSession_Free(&g_triggerSession);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Wait for intake thread to exit, cancel door trigger subscription and free trigger session.
+ * @param subscription door trigger execute subscription
+ */
+static void StopTriggerIntake(AwaClientChangeSubscription *subscription)
+{
+    if (g_triggerSession == NULL)
+    {
+        return;
+    }
+    pthread_join(g_triggerThread, NULL);
+
+    AwaClientSubscribeOperation *cancelSubscribeOperation = AwaClientSubscribeOperation_New(g_triggerSession);
+    AwaClientSubscribeOperation_AddCancelExecuteSubscription(cancelSubscribeOperation, subscription);
+    AwaClientSubscribeOperation_Perform(cancelSubscribeOperation, OPERATION_PERFORM_TIMEOUT);
+    AwaClientSubscribeOperation_Free(&cancelSubscribeOperation);
+    AwaClientSession_Disconnect(g_triggerSession);
+    AwaClientSession_Free(&g_triggerSession);
+}
 
 /**
  * @brief  Sesame gateway application handles door actions and notifies about 
@@ -488,6 +892,20 @@ int main(int argc, char **argv)
         LOG(LOG_INFO, " - %d/%d/%d", DOOR_OBJECT_ID, DOOR_OBJ_INSTANCE_CLOSE, DOOR_COUNTER_RESET_RESOURCE_ID);
     }
 
+    if (g_keepRunning && g_realTimePriority > 0)
+    {
+        char relayValuePath[GPIO_VALUE_PATH_SIZE];
+
+        // Let LetMeCreate set up the relay pin and leave it off before the lane takes it over
+        ChangeRelayState(false);
+        if (!GetRelayValuePath(relayValuePath, sizeof relayValuePath) ||
+            !RtLane_Start(g_realTimePriority, relayValuePath, g_relayHoldMs))
+        {
+            LOG(LOG_ERR, "Failed to start real-time relay lane. Exiting...");
+            g_keepRunning = false;
+        }
+    }
+
     opto_click_read_channel(OPTO_MIKROBUS_INDEX, OPTO_CHANNEL_DOOR_OPENED, &g_optoOpenedState);
     opto_click_read_channel(OPTO_MIKROBUS_INDEX, OPTO_CHANNEL_DOOR_CLOSED, &g_optoClosedState);
     setOptoClickStateResource(session, OPTO_OBJ_INSTANCE_DOOR_OPENED, g_optoOpenedState);
@@ -499,37 +917,104 @@ int main(int argc, char **argv)
     AwaClientChangeSubscription *subscription3 = AwaClientExecuteSubscription_New("/13201/1/5505", doorCounterResetCallback, &doorClosInstanceID);
     AwaClientChangeSubscription *subscription4 = AwaClientExecuteSubscription_New("/13201/2/5505", doorCounterResetCallback, &doorOperateInstanceID);
     AwaClientSubscribeOperation *subscribeOperation = AwaClientSubscribeOperation_New(session);
-    AwaClientSubscribeOperation_AddExecuteSubscription(subscribeOperation, subscription1);
+    if (g_realTimePriority == 0)
+    {
+        AwaClientSubscribeOperation_AddExecuteSubscription(subscribeOperation, subscription1);
+    }
     AwaClientSubscribeOperation_AddExecuteSubscription(subscribeOperation, subscription2);
     AwaClientSubscribeOperation_AddExecuteSubscription(subscribeOperation, subscription3);
     AwaClientSubscribeOperation_AddExecuteSubscription(subscribeOperation, subscription4);
     AwaClientSubscribeOperation_Perform(subscribeOperation, OPERATION_PERFORM_TIMEOUT);
     AwaClientSubscribeOperation_Free(&subscribeOperation);
 
+    if (g_keepRunning && g_realTimePriority > 0 && !StartTriggerIntake(subscription1))
+    {
+        LOG(LOG_ERR, "Failed to receive door triggers outside main loop. Exiting...");
+        g_keepRunning = false;
+    }
+
     if (g_keepRunning)
     {
-        opto_click_attach_callback(OPTO_MIKROBUS_INDEX, OPTO_CHANNEL_DOOR_OPENED, optoClickDoorOpenedCallback);
-        opto_click_attach_callback(OPTO_MIKROBUS_INDEX, OPTO_CHANNEL_DOOR_CLOSED, optoClickDoorClosedCallback);
+        if (g_realTimePriority > 0)
+        {
+            RtLane_AttachEdgeCallbacks(AttachOptoClickCallbacks);
+        }
+        else
+        {
+            AttachOptoClickCallbacks();
+        }
         LOG(LOG_INFO, "Observing Opto Clicks state");
     }
 
+    pthread_t benchmarkThread;
+    bool benchmarkRunning = false;
+    if (g_keepRunning && g_benchmarkCount > 0)
+    {
+        if (pthread_create(&benchmarkThread, NULL, BenchmarkTriggerThread, NULL) == 0)
+        {
+            benchmarkRunning = true;
+            LOG(LOG_INFO, "Benchmark: injecting %d door triggers under synthetic telemetry load",
+                g_benchmarkCount);
+        }
+        else
+        {
+            LOG(LOG_ERR, "Failed to start benchmark. Exiting...");
+            g_keepRunning = false;
+        }
+    }
+
     while (g_keepRunning)
     {
+        // Process() blocks until a notification arrives or the timeout expires
         AwaClientSession_Process(session, OPERATION_PERFORM_TIMEOUT);
         AwaClientSession_DispatchCallbacks(session);
-        gettimeofday(&g_sleepEnd, NULL);
-        struct timeval sleepTime;
-        timersub(&g_sleepEnd, &g_sleepBegin, &sleepTime);
-        if (sleepTime.tv_sec >= 3 && g_relayState)
+        if (g_realTimePriority > 0)
         {
-            ChangeRelayState(false);
+            // Door triggers and relay release are handled by intake thread and real-time lane,
+            // only report what they did
+            ProcessRtLaneEvents();
         }
-        sleep(1);
+        else
+        {
+            DispatchBenchmarkTrigger();
+            gettimeofday(&g_sleepEnd, NULL);
+            struct timeval sleepTime;
+            timersub(&g_sleepEnd, &g_sleepBegin, &sleepTime);
+            if (sleepTime.tv_sec * 1000 + sleepTime.tv_usec / 1000 >= g_relayHoldMs && g_relayState)
+            {
+                ChangeRelayState(false);
+            }
+        }
+        if (g_benchmarkCount > 0)
+        {
+            PublishSyntheticTelemetry();
+        }
+        if (g_realTimePriority == 0)
+        {
+            sleep(1);
+        }
+    }
+
+    if (benchmarkRunning)
+    {
+        pthread_join(benchmarkThread, NULL);
+        PrintBenchmarkStats();
+    }
+
+    if (g_realTimePriority > 0)
+    {
+        StopTriggerIntake(subscription1);
+        RtLane_Stop();
+        ProcessRtLaneEvents();
+        PrintRtLaneStats();
     }
 
     // Unsubscribe from all subscriptions
     AwaClientSubscribeOperation *cancelSubscribeOperation = AwaClientSubscribeOperation_New(session);
-    AwaClientSubscribeOperation_AddCancelExecuteSubscription(cancelSubscribeOperation, subscription1);
+    if (g_realTimePriority == 0)
+    {
+        AwaClientSubscribeOperation_AddCancelExecuteSubscription(cancelSubscribeOperation, subscription1);
+    }
     AwaClientSubscribeOperation_AddCancelExecuteSubscription(cancelSubscribeOperation, subscription2);
     AwaClientSubscribeOperation_AddCancelExecuteSubscription(cancelSubscribeOperation, subscription3);
     AwaClientSubscribeOperation_AddCancelExecuteSubscription(cancelSubscribeOperation, subscription4);